@@ -0,0 +1,1311 @@
+#include "benchmark.h"
+
+/**
+ * End-to-end benchmark and load generator.
+ *
+ * Runs two scenarios and appends their results as a single JSON line to the output file,
+ * so that runs for different commits and build flags can be compared:
+ *  - keyed: synthetic records routed to key groups and folded into per-key-group state in-process,
+ *    measuring the cost of routing and state updates alone,
+ *  - cluster: a local coordinator with N workers, with records sent to the workers' data endpoints
+ *    and processed there, while the cluster is grown by one worker, shrunk back, and restarted altogether.
+ */
+
+
+/**
+ * Get the current value of a monotonic clock in nanoseconds.
+ */
+long flout_bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+/**
+ * Get user and system CPU time consumed by this process so far, in nanoseconds.
+ */
+long flout_bench_cpu_ns()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000L
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000L;
+}
+
+
+/**
+ * Get resident set size of a running process in kilobytes, or -1 if it can't be read.
+ */
+long flout_bench_rss_kb(const pid_t pid)
+{
+    char path[64];
+    char line[256];
+    long rss_kb = -1;
+    FILE * status_file;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    status_file = fopen(path, "r");
+    if (status_file == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), status_file) != NULL) {
+        if (sscanf(line, "VmRSS: %ld kB", &rss_kb) == 1) {
+            break;
+        }
+    }
+    fclose(status_file);
+
+    return rss_kb;
+}
+
+
+/**
+ * Get user and system CPU time consumed so far by another process, in nanoseconds, or -1 if it can't be read.
+ */
+long flout_bench_process_cpu_ns(const pid_t pid)
+{
+    char path[64];
+    char stat_buffer[1024];
+    char * fields;
+    unsigned long user_ticks, system_ticks;
+    size_t n_read;
+    FILE * stat_file;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    stat_file = fopen(path, "r");
+    if (stat_file == NULL) {
+        return -1;
+    }
+    n_read = fread(stat_buffer, 1, sizeof(stat_buffer) - 1, stat_file);
+    fclose(stat_file);
+    stat_buffer[n_read] = '\0';
+
+    // The process name may contain spaces, so start after its closing parenthesis.
+    // utime and stime are the 14th and 15th fields.
+    fields = strrchr(stat_buffer, ')');
+    if (fields == NULL
+        || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+            &user_ticks, &system_ticks) != 2) {
+        return -1;
+    }
+
+    return (long) ((user_ticks + system_ticks) * (1000000000.0 / sysconf(_SC_CLK_TCK)));
+}
+
+
+static int flout_bench_compare_longs(const void * a, const void * b)
+{
+    long value_a = *(const long *) a;
+    long value_b = *(const long *) b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+
+/**
+ * Fill in result from latencies (in nanoseconds) of batches of batch_size records each,
+ * and wall time and CPU time taken by n_records records altogether. Sorts latencies in place.
+ */
+void flout_bench_summarize(long * latencies_ns, const long n_batches, const long batch_size, const long n_records,
+    const long wall_ns, const long cpu_ns, flout_bench_load_result_t * result)
+{
+    result->n_records = n_records;
+    result->batch_size = batch_size;
+    result->throughput_per_s = wall_ns > 0 ? n_records / (wall_ns / 1e9) : 0;
+    result->cpu_ns_per_record = n_records > 0 ? (double) cpu_ns / n_records : 0;
+    if (n_batches == 0) {
+        result->p50_us = result->p99_us = result->p999_us = result->max_us = 0;
+        return;
+    }
+
+    qsort(latencies_ns, n_batches, sizeof(long), flout_bench_compare_longs);
+    result->p50_us = latencies_ns[(long) ((n_batches - 1) * 0.5)] / 1e3;
+    result->p99_us = latencies_ns[(long) ((n_batches - 1) * 0.99)] / 1e3;
+    result->p999_us = latencies_ns[(long) ((n_batches - 1) * 0.999)] / 1e3;
+    result->max_us = latencies_ns[n_batches - 1] / 1e3;
+}
+
+
+/**
+ * Get the next synthetic key. xorshift64 makes for cheap, reproducible keys.
+ */
+uint64_t flout_bench_next_key(uint64_t * state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+
+/**
+ * Route n_records synthetic keyed records to key groups owned by n_workers workers,
+ * and fold their values into per-key-group state, as a stateful operator would.
+ */
+void flout_bench_keyed(const long n_records, const int n_workers, flout_bench_load_result_t * result)
+{
+    const char * log_name = "flout_bench_keyed";
+
+    int worker_ids[FLOUT_RING_MAX_WORKERS];
+    int owners[FLOUT_KEY_GROUPS];
+    long key_group_state[FLOUT_KEY_GROUPS] = {0};
+    long records_per_worker[FLOUT_RING_MAX_WORKERS] = {0};
+    int n_placed = n_workers > 0 ? n_workers : 1;
+
+    uint64_t key_state = 88172645463325252ull;
+    uint64_t key;
+    int key_group;
+    long n_batches = (n_records + FLOUT_BENCH_BATCH_SIZE - 1) / FLOUT_BENCH_BATCH_SIZE;
+    long * latencies_ns;
+    long start_ns, wall_start_ns, cpu_start_ns;
+    long checksum = 0;
+
+    for (int i = 0; i < n_placed; ++i) {
+        worker_ids[i] = i;
+    }
+    n_placed = flout_assign_key_groups(worker_ids, n_placed, owners);
+
+    latencies_ns = malloc(n_batches * sizeof(long));
+
+    cpu_start_ns = flout_bench_cpu_ns();
+    wall_start_ns = flout_bench_now_ns();
+    for (long batch = 0; batch < n_batches; ++batch) {
+        start_ns = flout_bench_now_ns();
+        for (long i = batch * FLOUT_BENCH_BATCH_SIZE; i < n_records && i < (batch + 1) * FLOUT_BENCH_BATCH_SIZE; ++i) {
+            key = flout_bench_next_key(&key_state);
+            key_group = flout_key_group_of(&key, sizeof(key));
+            ++records_per_worker[owners[key_group]];
+            key_group_state[key_group] += key & 0xff;
+        }
+        latencies_ns[batch] = flout_bench_now_ns() - start_ns;
+    }
+    flout_bench_summarize(latencies_ns, n_batches, FLOUT_BENCH_BATCH_SIZE, n_records,
+        flout_bench_now_ns() - wall_start_ns, flout_bench_cpu_ns() - cpu_start_ns, result);
+
+    free(latencies_ns);
+
+    // Make the state observable, so that the work above can't be optimized away.
+    for (int kg = 0; kg < FLOUT_KEY_GROUPS; ++kg) {
+        checksum += key_group_state[kg];
+    }
+    log_message(DEBUG, log_name, "state checksum %ld, records on worker 0: %ld", checksum, records_per_worker[0]);
+
+    log_message(INFO, log_name, "%ld records on %d workers: %.0f/s, per batch of %d: p50 %.1f us, p99 %.1f us, "
+        "p999 %.1f us", n_records, n_placed, result->throughput_per_s, FLOUT_BENCH_BATCH_SIZE,
+        result->p50_us, result->p99_us, result->p999_us);
+}
+
+
+/**
+ * Start a process running the binary at path with args, with its standard output redirected to stdout_fd.
+ * Returns the PID of the child or -1 on failure.
+ */
+pid_t flout_bench_spawn(const char * path, char * const args[], const int stdout_fd)
+{
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        dup2(stdout_fd, STDOUT_FILENO);
+        execv(path, args);
+        _exit(127);
+    }
+
+    return pid;
+}
+
+
+/**
+ * Read the next line from reader into line (of line_size bytes, zero-terminated, without the newline),
+ * waiting for it no later than deadline_ms, as returned by get_current_time_ms().
+ * Lines longer than line_size are truncated.
+ * Returns 1 if a line has been read, 0 if the deadline has passed, or -1 if the pipe has been closed.
+ */
+int flout_bench_read_line(flout_bench_line_reader_t * reader, char * line, const size_t line_size,
+    const time_t deadline_ms)
+{
+    struct pollfd pollfds[1];
+    char * newline;
+    size_t line_length;
+    ssize_t n_read;
+    time_t remaining_ms;
+    int ret_value;
+
+    pollfds[0].fd = reader->fd;
+    pollfds[0].events = POLLIN;
+
+    while (1) {
+        newline = memchr(reader->buffer, '\n', reader->length);
+        if (newline != NULL || reader->length == sizeof(reader->buffer)) {
+            // Either there is a complete line, or it can't fit the buffer and is cut short.
+            line_length = newline != NULL ? (size_t) (newline - reader->buffer) : reader->length;
+            snprintf(line, line_size, "%.*s", (int) line_length, reader->buffer);
+            if (newline != NULL) {
+                ++line_length;
+            }
+            reader->length -= line_length;
+            memmove(reader->buffer, reader->buffer + line_length, reader->length);
+            return 1;
+        }
+
+        remaining_ms = deadline_ms - get_current_time_ms();
+        if (remaining_ms <= 0) {
+            return 0;
+        }
+        ret_value = poll(pollfds, 1, remaining_ms);
+        if (ret_value < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ret_value <= 0) {
+            // Timed out or interrupted, the deadline is checked again above.
+            continue;
+        }
+
+        n_read = read(reader->fd, reader->buffer + reader->length, sizeof(reader->buffer) - reader->length);
+        if (n_read <= 0) {
+            return -1;
+        }
+        reader->length += n_read;
+    }
+}
+
+
+/**
+ * Follow coordinator logs until it reports having rescaled onto n_workers workers with every key group owned,
+ * or until deadline_ms. Every rescaling read on the way is stored into rescale (if not NULL), so that
+ * a negative n_workers just drains the logs until the deadline, keeping the last rescaling.
+ * Returns 1 if the coordinator has rescaled onto n_workers, 0 if the deadline has passed,
+ * or -1 if the coordinator has exited.
+ */
+int flout_bench_follow_log(flout_bench_line_reader_t * coordinator_log, const int n_workers,
+    const time_t deadline_ms, flout_bench_rescale_t * rescale)
+{
+    char line[512];
+    char * found;
+    flout_bench_rescale_t found_rescale;
+    int ret_value;
+
+    while ((ret_value = flout_bench_read_line(coordinator_log, line, sizeof(line), deadline_ms)) > 0) {
+        found = strstr(line, "rescaled onto ");
+        if (found != NULL
+            && sscanf(found, "rescaled onto %d workers: moved %d of %*d key groups in %ld us, %d unassigned",
+                &found_rescale.n_workers, &found_rescale.moved_key_groups, &found_rescale.duration_us,
+                &found_rescale.n_unassigned) == 4) {
+            if (rescale != NULL) {
+                *rescale = found_rescale;
+            }
+            if (found_rescale.n_workers == n_workers && found_rescale.n_unassigned == 0) {
+                return 1;
+            }
+        }
+    }
+
+    return ret_value;
+}
+
+
+/**
+ * Follow coordinator logs until it reports having rescaled onto n_workers workers with every key group owned,
+ * and store the number of moved key groups and the time the coordinator took into rescale.
+ * Returns 0 on success, or -1 if the coordinator has gone away or not rescaled in time.
+ */
+int flout_bench_wait_for_rescale(flout_bench_line_reader_t * coordinator_log, const int n_workers,
+    flout_bench_rescale_t * rescale)
+{
+    const char * log_name = "flout_bench_wait_for_rescale";
+
+    int ret_value = flout_bench_follow_log(coordinator_log, n_workers,
+        get_current_time_ms() + FLOUT_BENCH_RESCALE_TIMEOUT_MS, rescale);
+
+    if (ret_value == 0) {
+        log_message(ERROR, log_name, "coordinator did not rescale onto %d workers in time", n_workers);
+    }
+    else if (ret_value < 0) {
+        log_message(ERROR, log_name, "coordinator has exited");
+    }
+    return ret_value > 0 ? 0 : -1;
+}
+
+
+/**
+ * Follow logs until a line containing text shows up, or until deadline_ms.
+ * Returns 1 if it has shown up, 0 if the deadline has passed, or -1 if the process has exited.
+ */
+int flout_bench_wait_for_line(flout_bench_line_reader_t * reader, const char * text, const time_t deadline_ms)
+{
+    char line[512];
+    int ret_value;
+
+    while ((ret_value = flout_bench_read_line(reader, line, sizeof(line), deadline_ms)) > 0) {
+        if (strstr(line, text) != NULL) {
+            return 1;
+        }
+    }
+
+    return ret_value;
+}
+
+
+/**
+ * Start the coordinator of a local cluster, with binaries taken from bin_dir.
+ * Its output is followed through cluster->coordinator_log, while workers' output is discarded.
+ * Returns 0 on success or -1 on failure.
+ */
+int flout_bench_start_coordinator(flout_bench_cluster_t * cluster, const char * bin_dir)
+{
+    const char * log_name = "flout_bench_start_coordinator";
+
+    int coordinator_pipe[2];
+
+    snprintf(cluster->coordinator_path, sizeof(cluster->coordinator_path), "%s/coordinator", bin_dir);
+    snprintf(cluster->worker_path, sizeof(cluster->worker_path), "%s/worker", bin_dir);
+
+    if (pipe(coordinator_pipe) < 0) {
+        log_message(ERROR, log_name, "could not create a pipe: %s", strerror(errno));
+        return -1;
+    }
+
+    char * const coordinator_args[] = {cluster->coordinator_path, NULL};
+    cluster->coordinator_pid = flout_bench_spawn(cluster->coordinator_path, coordinator_args, coordinator_pipe[1]);
+    close(coordinator_pipe[1]);
+    if (cluster->coordinator_pid < 0) {
+        log_message(ERROR, log_name, "could not start coordinator: %s", strerror(errno));
+        cluster->coordinator_pid = 0;
+        close(coordinator_pipe[0]);
+        return -1;
+    }
+    cluster->coordinator_log.fd = coordinator_pipe[0];
+    cluster->coordinator_log.length = 0;
+
+    // Workers can only register once the coordinator is listening.
+    if (flout_bench_wait_for_line(&cluster->coordinator_log, "accepting worker registrations",
+            get_current_time_ms() + FLOUT_BENCH_CONNECT_TIMEOUT_MS) <= 0) {
+        log_message(ERROR, log_name, "coordinator did not start accepting workers");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Start the worker at position index, listening on FLOUT_BENCH_FIRST_WORKER_PORT + index.
+ * Returns 0 on success or -1 on failure.
+ */
+int flout_bench_start_worker(flout_bench_cluster_t * cluster, const int index)
+{
+    const char * log_name = "flout_bench_start_worker";
+
+    char port_buffer[16];
+
+    snprintf(port_buffer, sizeof(port_buffer), "%d", FLOUT_BENCH_FIRST_WORKER_PORT + index);
+    char * const worker_args[] = {cluster->worker_path, port_buffer, NULL};
+
+    cluster->worker_pids[index] = flout_bench_spawn(cluster->worker_path, worker_args, cluster->null_fd);
+    if (cluster->worker_pids[index] < 0) {
+        log_message(ERROR, log_name, "could not start worker: %s", strerror(errno));
+        cluster->worker_pids[index] = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Take the worker at position index down without warning, as if it had crashed.
+ */
+void flout_bench_kill_worker(flout_bench_cluster_t * cluster, const int index)
+{
+    if (cluster->worker_pids[index] > 0) {
+        kill(cluster->worker_pids[index], SIGKILL);
+        waitpid(cluster->worker_pids[index], NULL, 0);
+        cluster->worker_pids[index] = 0;
+    }
+}
+
+
+/**
+ * Kill all workers and the coordinator.
+ */
+void flout_bench_stop_cluster(flout_bench_cluster_t * cluster)
+{
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        flout_bench_kill_worker(cluster, i);
+    }
+    if (cluster->coordinator_pid > 0) {
+        kill(cluster->coordinator_pid, SIGKILL);
+        waitpid(cluster->coordinator_pid, NULL, 0);
+        cluster->coordinator_pid = 0;
+        close(cluster->coordinator_log.fd);
+    }
+}
+
+
+/**
+ * Get CPU time consumed so far by the coordinator (if coordinator is non-zero) or by all running workers,
+ * in nanoseconds.
+ */
+long flout_bench_cluster_cpu_ns(const flout_bench_cluster_t * cluster, const int coordinator)
+{
+    long cpu_ns = 0;
+
+    if (coordinator) {
+        return flout_bench_process_cpu_ns(cluster->coordinator_pid);
+    }
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        if (cluster->worker_pids[i] > 0) {
+            cpu_ns += flout_bench_process_cpu_ns(cluster->worker_pids[i]);
+        }
+    }
+    return cpu_ns;
+}
+
+
+/**
+ * Record the largest RSS seen so far of the coordinator and of any single worker into result.
+ */
+void flout_bench_sample_cluster_rss(const flout_bench_cluster_t * cluster, flout_bench_cluster_result_t * result)
+{
+    long rss_kb = flout_bench_rss_kb(cluster->coordinator_pid);
+
+    if (rss_kb > result->coordinator_rss_kb) {
+        result->coordinator_rss_kb = rss_kb;
+    }
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        if (cluster->worker_pids[i] > 0) {
+            rss_kb = flout_bench_rss_kb(cluster->worker_pids[i]);
+            if (rss_kb > result->workers_rss_kb) {
+                result->workers_rss_kb = rss_kb;
+            }
+        }
+    }
+}
+
+
+/**
+ * Prepare a client that has no connections yet, and keeps up to pipeline records in flight.
+ */
+void flout_bench_client_init(flout_bench_client_t * client, const int pipeline)
+{
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        client->socket_fds[i] = -1;
+        client->in_flight[i] = malloc(pipeline * sizeof(int));
+        client->in_flight_head[i] = 0;
+        client->n_in_flight[i] = 0;
+    }
+    memset(client->routes, 0, sizeof(client->routes));
+    client->sequence = 0;
+    client->n_redirects = 0;
+    client->pipeline = pipeline;
+    client->records = calloc(pipeline, sizeof(flout_bench_record_t));
+}
+
+
+/**
+ * Connect to the data endpoint of the worker at position index, retrying while it starts up.
+ * Returns the connected socket, or -1 on failure.
+ */
+int flout_bench_connect_worker(const int index)
+{
+    const char * log_name = "flout_bench_connect_worker";
+
+    struct sockaddr_in6 worker_addr = {0};
+    time_t deadline_ms = get_current_time_ms() + FLOUT_BENCH_CONNECT_TIMEOUT_MS;
+    int socket_fd;
+
+    flout_init_sockaddr_in6(&worker_addr, "::1", FLOUT_BENCH_FIRST_WORKER_PORT + index);
+
+    while (1) {
+        socket_fd = socket(AF_INET6, SOCK_STREAM, 0);
+        if (socket_fd < 0) {
+            log_message(ERROR, log_name, "could not create a socket: %s", strerror(errno));
+            return -1;
+        }
+        if (connect(socket_fd, (struct sockaddr *) &worker_addr, sizeof(worker_addr)) == 0) {
+            break;
+        }
+        close(socket_fd);
+        if (get_current_time_ms() > deadline_ms) {
+            log_message(ERROR, log_name, "could not connect to worker %d: %s", index, strerror(errno));
+            return -1;
+        }
+        usleep(10000);
+    }
+
+    // Replies are read from all workers as they arrive, so reads must not block.
+    fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    return socket_fd;
+}
+
+
+/**
+ * Close the connection to the worker at position index. Records in flight on it are to be sent again,
+ * starting with the next worker.
+ */
+void flout_bench_client_disconnect(flout_bench_client_t * client, const int index)
+{
+    flout_bench_record_t * record;
+
+    if (client->socket_fds[index] < 0) {
+        return;
+    }
+    close(client->socket_fds[index]);
+    client->socket_fds[index] = -1;
+
+    for (int i = 0; i < client->n_in_flight[index]; ++i) {
+        record = &client->records[client->in_flight[index][(client->in_flight_head[index] + i) % client->pipeline]];
+        record->in_flight = 0;
+        record->worker = index;
+    }
+    client->in_flight_head[index] = 0;
+    client->n_in_flight[index] = 0;
+}
+
+
+/**
+ * Close all connections and release memory held by the client.
+ */
+void flout_bench_client_free(flout_bench_client_t * client)
+{
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        flout_bench_client_disconnect(client, i);
+        free(client->in_flight[i]);
+    }
+    free(client->records);
+}
+
+
+/**
+ * Send the record at record_index to the worker most likely to own its key group: the worker that has processed
+ * the key group last, or, for a record that has been refused, the next connected worker after the one that has
+ * refused it. Workers whose connection fails are disconnected.
+ * Returns 0 if the record has been sent, or -1 if there are no connected workers.
+ */
+int flout_bench_client_send(flout_bench_client_t * client, const int record_index)
+{
+    flout_bench_record_t * record = &client->records[record_index];
+    char message[FLOUT_RPC_MSG_SIZE];
+    int key_group = flout_key_group_of(&record->key, sizeof(record->key));
+    int first = record->worker < 0 ? client->routes[key_group] : record->worker + 1;
+    int index;
+
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        index = (first + i) % MAX_CONNECTED_WORKERS;
+        if (client->socket_fds[index] < 0) {
+            continue;
+        }
+
+        record->sequence = ++client->sequence;
+        memset(message, 0, sizeof(message));
+        snprintf(message, sizeof(message), "%c %ld %" PRIu64, FLOUT_RPC_CMD_RECORD, record->sequence, record->key);
+        if (flout_rpc_send(client->socket_fds[index], message) < 0) {
+            flout_bench_client_disconnect(client, index);
+            continue;
+        }
+
+        client->in_flight[index][(client->in_flight_head[index] + client->n_in_flight[index]) % client->pipeline] =
+            record_index;
+        ++client->n_in_flight[index];
+        record->worker = index;
+        record->in_flight = 1;
+        return 0;
+    }
+
+    return -1;
+}
+
+
+/**
+ * Read the next reply from the worker at position index, if one has arrived, and match it with the oldest record
+ * in flight on that connection. processed_index is set to the index of that record if it has been processed,
+ * or to -1 otherwise. A refused record is to be sent to the next worker, and once every connected worker
+ * has refused it, only after FLOUT_BENCH_RETRY_INTERVAL_MS.
+ * Workers whose connection fails, or whose replies get out of sync, are disconnected.
+ * Returns 1 if a reply has been handled, 0 if there is none yet, or -1 if the worker has been disconnected.
+ */
+int flout_bench_client_receive(flout_bench_client_t * client, const int index, int * processed_index)
+{
+    flout_bench_record_t * record;
+    char message[FLOUT_RPC_MSG_SIZE];
+    int record_index;
+    int n_connected = 0;
+    int ret_value;
+    char reply;
+    long sequence;
+
+    *processed_index = -1;
+    if (client->socket_fds[index] < 0 || client->n_in_flight[index] == 0) {
+        return 0;
+    }
+
+    ret_value = flout_rpc_recv(client->socket_fds[index], message);
+    if (ret_value > 0) {
+        return 0;
+    }
+    if (ret_value < 0) {
+        flout_bench_client_disconnect(client, index);
+        return -1;
+    }
+
+    record_index = client->in_flight[index][client->in_flight_head[index]];
+    record = &client->records[record_index];
+    message[FLOUT_RPC_MSG_SIZE-1] = '\0';
+    if (sscanf(message, "%c %ld", &reply, &sequence) != 2 || sequence != record->sequence) {
+        // Replies are out of sync, so this connection can't be trusted anymore.
+        flout_bench_client_disconnect(client, index);
+        return -1;
+    }
+    client->in_flight_head[index] = (client->in_flight_head[index] + 1) % client->pipeline;
+    --client->n_in_flight[index];
+    record->in_flight = 0;
+
+    if (reply == FLOUT_RPC_CMD_PROCESSED) {
+        client->routes[flout_key_group_of(&record->key, sizeof(record->key))] = index;
+        *processed_index = record_index;
+        return 1;
+    }
+
+    ++client->n_redirects;
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        n_connected += client->socket_fds[i] >= 0;
+    }
+    if (++record->n_refusals >= n_connected) {
+        record->n_refusals = 0;
+        record->retry_ns = flout_bench_now_ns() + FLOUT_BENCH_RETRY_INTERVAL_MS * 1000000L;
+    }
+    return 1;
+}
+
+
+/**
+ * Prepare shared state of a load that isn't measuring any phase yet.
+ */
+void flout_bench_load_control_init(flout_bench_load_control_t * control)
+{
+    atomic_init(&control->phase, FLOUT_BENCH_PHASE_NONE);
+    atomic_init(&control->stop, 0);
+    atomic_init(&control->last_progress_ns, flout_bench_now_ns());
+    for (int phase = 0; phase < FLOUT_BENCH_PHASES; ++phase) {
+        atomic_init(&control->no_progress_ns[phase], 0);
+    }
+}
+
+
+/**
+ * Record that no records have been processed for no_progress_ns during phase, if that's the longest so far.
+ */
+void flout_bench_load_no_progress(flout_bench_load_control_t * control, const int phase, const long no_progress_ns)
+{
+    long longest_ns;
+
+    if (phase == FLOUT_BENCH_PHASE_NONE) {
+        return;
+    }
+    longest_ns = atomic_load(&control->no_progress_ns[phase]);
+    while (no_progress_ns > longest_ns
+        && !atomic_compare_exchange_weak(&control->no_progress_ns[phase], &longest_ns, no_progress_ns)) {
+    }
+}
+
+
+/**
+ * Make the load thread attribute records to phase from now on.
+ * A stall that's still going on is split between the phase that ends and the one that begins.
+ */
+void flout_bench_load_switch_phase(flout_bench_load_control_t * control, const int phase)
+{
+    long now_ns = flout_bench_now_ns();
+    int previous_phase = atomic_exchange(&control->phase, phase);
+
+    flout_bench_load_no_progress(control, previous_phase, now_ns - atomic_exchange(&control->last_progress_ns, now_ns));
+}
+
+
+/**
+ * Prepare the load of client client_id, with pipeline records, that has no connections and collects no latencies yet.
+ * Every client sends its own sequence of keys.
+ */
+void flout_bench_load_init(flout_bench_load_t * load, flout_bench_load_control_t * control, const int pipeline,
+    const int client_id)
+{
+    load->control = control;
+    flout_bench_client_init(&load->client, pipeline);
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        atomic_init(&load->pending_fds[i], -1);
+    }
+    load->key_state = 88172645463325252ull + client_id * 0x9e3779b97f4a7c15ull;
+    for (int phase = 0; phase < FLOUT_BENCH_PHASES; ++phase) {
+        load->latencies_ns[phase] = NULL;
+        load->n_records[phase] = 0;
+        load->capacity[phase] = 0;
+    }
+}
+
+
+/**
+ * Release everything held by a load whose thread is not running.
+ */
+void flout_bench_load_free(flout_bench_load_t * load)
+{
+    int socket_fd;
+
+    flout_bench_client_free(&load->client);
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        socket_fd = atomic_exchange(&load->pending_fds[i], -1);
+        if (socket_fd >= 0) {
+            close(socket_fd);
+        }
+    }
+    for (int phase = 0; phase < FLOUT_BENCH_PHASES; ++phase) {
+        free(load->latencies_ns[phase]);
+        load->latencies_ns[phase] = NULL;
+    }
+}
+
+
+/**
+ * Connect to the data endpoint of the worker at position index, and hand the connection over to the load thread,
+ * which replaces any previous connection to that worker with it. Returns 0 on success or -1 on failure.
+ */
+int flout_bench_load_connect(flout_bench_load_t * load, const int index)
+{
+    int socket_fd = flout_bench_connect_worker(index);
+    int previous_fd;
+
+    if (socket_fd < 0) {
+        return -1;
+    }
+    previous_fd = atomic_exchange(&load->pending_fds[index], socket_fd);
+    if (previous_fd >= 0) {
+        close(previous_fd);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Connect every one of n_clients loads to the worker at position index.
+ * Returns 0 on success or -1 on failure.
+ */
+int flout_bench_connect_clients(flout_bench_load_t * loads, const int n_clients, const int index)
+{
+    for (int i = 0; i < n_clients; ++i) {
+        if (flout_bench_load_connect(&loads[i], index) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Summarize latencies of records processed during phase by all n_clients loads into result,
+ * over duration_ms of that phase.
+ */
+void flout_bench_summarize_phase(flout_bench_load_t * loads, const int n_clients, const int phase,
+    const long duration_ms, flout_bench_load_result_t * result)
+{
+    long n_records = 0;
+    long * latencies_ns;
+
+    for (int i = 0; i < n_clients; ++i) {
+        n_records += loads[i].n_records[phase];
+    }
+    latencies_ns = malloc((n_records > 0 ? n_records : 1) * sizeof(long));
+    n_records = 0;
+    for (int i = 0; i < n_clients; ++i) {
+        memcpy(latencies_ns + n_records, loads[i].latencies_ns[phase], loads[i].n_records[phase] * sizeof(long));
+        n_records += loads[i].n_records[phase];
+    }
+
+    flout_bench_summarize(latencies_ns, n_records, 1, n_records, duration_ms * 1000000L, 0, result);
+    free(latencies_ns);
+}
+
+
+/**
+ * Store the latency of a record processed during phase.
+ */
+static void flout_bench_load_add(flout_bench_load_t * load, const int phase, const long latency_ns)
+{
+    if (phase == FLOUT_BENCH_PHASE_NONE) {
+        return;
+    }
+    if (load->n_records[phase] == load->capacity[phase]) {
+        load->capacity[phase] = load->capacity[phase] > 0 ? load->capacity[phase] * 2 : 65536;
+        load->latencies_ns[phase] = realloc(load->latencies_ns[phase], load->capacity[phase] * sizeof(long));
+    }
+    load->latencies_ns[phase][load->n_records[phase]++] = latency_ns;
+}
+
+
+/**
+ * Issue a new record at record_index, in place of one that has been processed.
+ */
+static void flout_bench_load_issue(flout_bench_load_t * load, const int record_index, const long now_ns)
+{
+    flout_bench_record_t * record = &load->client.records[record_index];
+
+    record->key = flout_bench_next_key(&load->key_state);
+    record->start_ns = now_ns;
+    record->retry_ns = 0;
+    record->worker = -1;
+    record->n_refusals = 0;
+    record->in_flight = 0;
+}
+
+
+/**
+ * Body of the thread sending records to the cluster until the load is stopped.
+ *
+ * As many records as the client's pipeline are kept in flight at once, and each record that's processed
+ * is replaced right away with a new one, so that an outage holds up the whole pipeline rather than a single record,
+ * and shows up as time without progress.
+ */
+void * flout_bench_load_thread_fn(void * msg)
+{
+    flout_bench_load_t * load = (flout_bench_load_t *) msg;
+    flout_bench_load_control_t * control = load->control;
+    flout_bench_client_t * client = &load->client;
+
+    struct pollfd pollfds[MAX_CONNECTED_WORKERS];
+    int polled_indices[MAX_CONNECTED_WORKERS];
+    int n_polled, n_waiting;
+    int processed_index;
+    int socket_fd;
+    int phase;
+    long now_ns = flout_bench_now_ns();
+
+    for (int i = 0; i < client->pipeline; ++i) {
+        flout_bench_load_issue(load, i, now_ns);
+    }
+
+    while (!atomic_load(&control->stop)) {
+        for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+            socket_fd = atomic_exchange(&load->pending_fds[i], -1);
+            if (socket_fd >= 0) {
+                flout_bench_client_disconnect(client, i);
+                client->socket_fds[i] = socket_fd;
+            }
+        }
+
+        // Send every record that isn't in flight, unless its key group has just turned out to have no owner.
+        now_ns = flout_bench_now_ns();
+        n_waiting = 0;
+        for (int i = 0; i < client->pipeline; ++i) {
+            if (client->records[i].in_flight) {
+                continue;
+            }
+            if (client->records[i].retry_ns > now_ns || flout_bench_client_send(client, i) < 0) {
+                ++n_waiting;
+            }
+        }
+
+        n_polled = 0;
+        for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+            if (client->socket_fds[i] >= 0 && client->n_in_flight[i] > 0) {
+                pollfds[n_polled].fd = client->socket_fds[i];
+                pollfds[n_polled].events = POLLIN;
+                polled_indices[n_polled++] = i;
+            }
+        }
+        if (n_polled == 0) {
+            // There is no one to send to at the moment.
+            usleep(FLOUT_BENCH_RETRY_INTERVAL_MS * 1000);
+            continue;
+        }
+        if (poll(pollfds, n_polled, n_waiting > 0 ? FLOUT_BENCH_RETRY_INTERVAL_MS : FLOUT_BENCH_POLL_INTERVAL_MS) <= 0) {
+            continue;
+        }
+
+        for (int i = 0; i < n_polled; ++i) {
+            if (pollfds[i].revents == 0) {
+                continue;
+            }
+            while (flout_bench_client_receive(client, polled_indices[i], &processed_index) > 0) {
+                if (processed_index < 0) {
+                    continue;
+                }
+                now_ns = flout_bench_now_ns();
+                phase = atomic_load(&control->phase);
+                flout_bench_load_add(load, phase, now_ns - client->records[processed_index].start_ns);
+                flout_bench_load_no_progress(control, phase,
+                    now_ns - atomic_exchange(&control->last_progress_ns, now_ns));
+                flout_bench_load_issue(load, processed_index, now_ns);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * End the current phase once window_ms have passed since phase_start_ms, and (unless n_workers is negative)
+ * the coordinator has rescaled onto n_workers workers with every key group owned. The time from event_ns,
+ * when membership has been changed, until then is stored along with that rescaling and the phase's duration.
+ * Returns 0 on success or -1 if the coordinator has exited or not rescaled in time.
+ */
+int flout_bench_finish_phase(flout_bench_cluster_t * cluster, const long event_ns, const time_t phase_start_ms,
+    const long window_ms, const int n_workers, flout_bench_phase_result_t * result)
+{
+    const char * log_name = "flout_bench_finish_phase";
+
+    if (n_workers >= 0) {
+        if (flout_bench_wait_for_rescale(&cluster->coordinator_log, n_workers, &result->rescale) < 0) {
+            return -1;
+        }
+        result->rescale_us = (flout_bench_now_ns() - event_ns) / 1000;
+    }
+
+    // Keep reading coordinator logs for the rest of the window, so that they don't back up.
+    if (flout_bench_follow_log(&cluster->coordinator_log, -1, phase_start_ms + window_ms, NULL) < 0) {
+        log_message(ERROR, log_name, "coordinator has exited");
+        return -1;
+    }
+
+    result->duration_ms = get_current_time_ms() - phase_start_ms;
+    return 0;
+}
+
+
+/**
+ * Start a local coordinator with n_workers workers and keep sending records through them from n_clients clients,
+ * each on its own thread with pipeline records in flight, while going through phases of window_ms each: steady state, one more worker joining, that worker crashing,
+ * and finally killing and restarting every process, as a stop-and-restart rescaling would. A phase lasts until
+ * the coordinator has rescaled if that takes longer than window_ms. Binaries are taken from bin_dir.
+ * Returns 0 on success or -1 on failure.
+ */
+int flout_bench_cluster(const char * bin_dir, const int n_workers, const long window_ms, const int n_clients,
+    const int pipeline, flout_bench_cluster_result_t * result)
+{
+    const char * log_name = "flout_bench_cluster";
+
+    const char * phase_names[FLOUT_BENCH_PHASES] = {"steady", "grow", "shrink", "restart"};
+    flout_bench_phase_result_t * phases = result->phases;
+    flout_bench_cluster_t cluster = {0};
+    flout_bench_rescale_t startup_rescale;
+    flout_bench_load_control_t control;
+    flout_bench_load_t * loads = calloc(n_clients, sizeof(flout_bench_load_t));
+    pthread_t * load_threads = calloc(n_clients, sizeof(pthread_t));
+    int n_started = 0;
+    time_t phase_start_ms, sample_deadline_ms;
+    long event_ns;
+    long coordinator_cpu_ns, workers_cpu_ns;
+    long n_steady_records;
+    int ret_value = -1;
+
+    result->n_workers = n_workers;
+    result->n_clients = n_clients;
+    result->pipeline = pipeline;
+    result->window_ms = window_ms;
+    flout_bench_load_control_init(&control);
+    for (int i = 0; i < n_clients; ++i) {
+        flout_bench_load_init(&loads[i], &control, pipeline, i);
+    }
+
+    cluster.null_fd = open("/dev/null", O_WRONLY);
+    if (flout_bench_start_coordinator(&cluster, bin_dir) < 0) {
+        goto cleanup;
+    }
+
+    // Bring the cluster up one worker at a time.
+    for (int i = 0; i < n_workers; ++i) {
+        if (flout_bench_start_worker(&cluster, i) < 0
+            || flout_bench_wait_for_rescale(&cluster.coordinator_log, i + 1, &startup_rescale) < 0
+            || flout_bench_connect_clients(loads, n_clients, i) < 0) {
+            goto cleanup;
+        }
+    }
+
+    for (; n_started < n_clients; ++n_started) {
+        pthread_create(&load_threads[n_started], NULL, flout_bench_load_thread_fn, (void *) &loads[n_started]);
+    }
+
+    // Steady state, where CPU time and RSS of the cluster processes are measured.
+    phase_start_ms = get_current_time_ms();
+    coordinator_cpu_ns = -flout_bench_cluster_cpu_ns(&cluster, 1);
+    workers_cpu_ns = -flout_bench_cluster_cpu_ns(&cluster, 0);
+    flout_bench_load_switch_phase(&control, FLOUT_BENCH_PHASE_STEADY);
+    while (get_current_time_ms() < phase_start_ms + window_ms) {
+        flout_bench_sample_cluster_rss(&cluster, result);
+        sample_deadline_ms = get_current_time_ms() + FLOUT_BENCH_RSS_SAMPLE_INTERVAL_MS;
+        if (sample_deadline_ms > phase_start_ms + window_ms) {
+            sample_deadline_ms = phase_start_ms + window_ms;
+        }
+        if (flout_bench_follow_log(&cluster.coordinator_log, -1, sample_deadline_ms, NULL) < 0) {
+            log_message(ERROR, log_name, "coordinator has exited");
+            goto cleanup;
+        }
+    }
+    flout_bench_load_switch_phase(&control, FLOUT_BENCH_PHASE_NONE);
+    coordinator_cpu_ns += flout_bench_cluster_cpu_ns(&cluster, 1);
+    workers_cpu_ns += flout_bench_cluster_cpu_ns(&cluster, 0);
+    phases[FLOUT_BENCH_PHASE_STEADY].duration_ms = get_current_time_ms() - phase_start_ms;
+
+    // A worker joins the running job.
+    phase_start_ms = get_current_time_ms();
+    event_ns = flout_bench_now_ns();
+    flout_bench_load_switch_phase(&control, FLOUT_BENCH_PHASE_GROW);
+    if (flout_bench_start_worker(&cluster, n_workers) < 0
+        || flout_bench_connect_clients(loads, n_clients, n_workers) < 0
+        || flout_bench_finish_phase(&cluster, event_ns, phase_start_ms, window_ms, n_workers + 1,
+            &phases[FLOUT_BENCH_PHASE_GROW]) < 0) {
+        goto cleanup;
+    }
+
+    // The same worker crashes.
+    phase_start_ms = get_current_time_ms();
+    event_ns = flout_bench_now_ns();
+    flout_bench_load_switch_phase(&control, FLOUT_BENCH_PHASE_SHRINK);
+    flout_bench_kill_worker(&cluster, n_workers);
+    if (flout_bench_finish_phase(&cluster, event_ns, phase_start_ms, window_ms, n_workers,
+            &phases[FLOUT_BENCH_PHASE_SHRINK]) < 0) {
+        goto cleanup;
+    }
+
+    // Every process is killed and started again, as rescaling by restarting the job would.
+    phase_start_ms = get_current_time_ms();
+    event_ns = flout_bench_now_ns();
+    flout_bench_load_switch_phase(&control, FLOUT_BENCH_PHASE_RESTART);
+    flout_bench_stop_cluster(&cluster);
+    if (flout_bench_start_coordinator(&cluster, bin_dir) < 0) {
+        goto cleanup;
+    }
+    for (int i = 0; i < n_workers; ++i) {
+        if (flout_bench_start_worker(&cluster, i) < 0) {
+            goto cleanup;
+        }
+    }
+    for (int i = 0; i < n_workers; ++i) {
+        if (flout_bench_connect_clients(loads, n_clients, i) < 0) {
+            goto cleanup;
+        }
+    }
+    if (flout_bench_finish_phase(&cluster, event_ns, phase_start_ms, window_ms, n_workers,
+            &phases[FLOUT_BENCH_PHASE_RESTART]) < 0) {
+        goto cleanup;
+    }
+    flout_bench_load_switch_phase(&control, FLOUT_BENCH_PHASE_NONE);
+
+    ret_value = 0;
+
+cleanup:
+    atomic_store(&control.stop, 1);
+    for (int i = 0; i < n_started; ++i) {
+        pthread_join(load_threads[i], NULL);
+    }
+    flout_bench_stop_cluster(&cluster);
+    close(cluster.null_fd);
+
+    if (ret_value == 0) {
+        for (int phase = 0; phase < FLOUT_BENCH_PHASES; ++phase) {
+            flout_bench_summarize_phase(loads, n_clients, phase, phases[phase].duration_ms, &phases[phase].load);
+            phases[phase].no_progress_ms = atomic_load(&control.no_progress_ns[phase]) / 1e6;
+            log_message(INFO, log_name, "%s: %ld records in %ld ms, %.0f/s, p50 %.1f us, p99 %.1f us, "
+                "p999 %.1f us, max %.1f us, longest without progress %.1f ms", phase_names[phase],
+                phases[phase].load.n_records, phases[phase].duration_ms, phases[phase].load.throughput_per_s,
+                phases[phase].load.p50_us, phases[phase].load.p99_us, phases[phase].load.p999_us,
+                phases[phase].load.max_us, phases[phase].no_progress_ms);
+        }
+
+        n_steady_records = phases[FLOUT_BENCH_PHASE_STEADY].load.n_records;
+        if (n_steady_records > 0) {
+            result->coordinator_cpu_ns_per_record = (double) coordinator_cpu_ns / n_steady_records;
+            result->workers_cpu_ns_per_record = (double) workers_cpu_ns / n_steady_records;
+        }
+        for (int i = 0; i < n_clients; ++i) {
+            result->n_redirects += loads[i].client.n_redirects;
+        }
+
+        log_message(INFO, log_name, "grew to %d workers in %ld us moving %d of %d key groups (%ld us of handover), "
+            "shrank back in %ld us moving %d (%ld us of handover)", n_workers + 1,
+            phases[FLOUT_BENCH_PHASE_GROW].rescale_us, phases[FLOUT_BENCH_PHASE_GROW].rescale.moved_key_groups,
+            FLOUT_KEY_GROUPS, phases[FLOUT_BENCH_PHASE_GROW].rescale.duration_us,
+            phases[FLOUT_BENCH_PHASE_SHRINK].rescale_us, phases[FLOUT_BENCH_PHASE_SHRINK].rescale.moved_key_groups,
+            phases[FLOUT_BENCH_PHASE_SHRINK].rescale.duration_us);
+    }
+    for (int i = 0; i < n_clients; ++i) {
+        flout_bench_load_free(&loads[i]);
+    }
+    free(loads);
+    free(load_threads);
+
+    return ret_value;
+}
+
+
+/**
+ * Write value to output as a quoted JSON string, escaping characters that JSON doesn't allow as they are.
+ */
+void flout_bench_write_json_string(FILE * output, const char * value)
+{
+    fputc('"', output);
+    for (const unsigned char * c = (const unsigned char *) value; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(output, "\\%c", *c);
+        }
+        else if (*c < 0x20) {
+            fprintf(output, "\\u%04x", *c);
+        }
+        else {
+            fputc(*c, output);
+        }
+    }
+    fputc('"', output);
+}
+
+
+/**
+ * Append a JSON object describing a load-driven scenario to output.
+ */
+void flout_bench_write_load_result(FILE * output, const char * name, const flout_bench_load_result_t * result)
+{
+    fprintf(output, "\"%s\":{\"records\":%ld,\"batch_records\":%ld,\"throughput_per_s\":%.1f,\"p50_us\":%.3f,"
+        "\"p99_us\":%.3f,\"p999_us\":%.3f,\"max_us\":%.3f,\"cpu_ns_per_record\":%.1f}", name, result->n_records,
+        result->batch_size, result->throughput_per_s, result->p50_us, result->p99_us, result->p999_us, result->max_us,
+        result->cpu_ns_per_record);
+}
+
+
+/**
+ * Append a JSON object describing a phase of the cluster scenario to output.
+ * Rescaling is only included for phases where the running job has been rescaled, rather than restarted:
+ * the time from the change of membership until every key group has had an owner again,
+ * and the part of it the coordinator has spent handing key groups over.
+ */
+void flout_bench_write_phase_result(FILE * output, const char * name, const flout_bench_phase_result_t * result,
+    const int with_rescale)
+{
+    fprintf(output, "\"%s\":{\"duration_ms\":%ld,\"records\":%ld,\"throughput_per_s\":%.1f,\"p50_us\":%.3f,"
+        "\"p99_us\":%.3f,\"p999_us\":%.3f,\"max_us\":%.3f,\"no_progress_ms\":%.3f", name, result->duration_ms,
+        result->load.n_records, result->load.throughput_per_s, result->load.p50_us, result->load.p99_us,
+        result->load.p999_us, result->load.max_us, result->no_progress_ms);
+    if (with_rescale) {
+        fprintf(output, ",\"rescale_us\":%ld,\"handover_us\":%ld,\"moved_key_groups\":%d", result->rescale_us,
+            result->rescale.duration_us, result->rescale.moved_key_groups);
+    }
+    fprintf(output, "}");
+}
+
+
+void flout_bench_usage(const char * program_name)
+{
+    fprintf(stderr, "usage: %s [-n workers] [-w phase window in ms] [-j clients]\n"
+        "       [-p records in flight per client] [-r keyed records]\n"
+        "       [-o output file] [-b binaries directory] [-c commit] [-f build flags]\n", program_name);
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char * log_name = "main";
+
+    int n_workers = 3;
+    long window_ms = 3000;
+    int n_clients = 4;
+    int pipeline = 16;
+    long n_records = 1000000;
+    const char * output_path = "bench_results.jsonl";
+    const char * bin_dir = "bin";
+    const char * commit = "unknown";
+    const char * build_flags = "";
+
+    flout_bench_load_result_t keyed_result = {0};
+    flout_bench_cluster_result_t cluster_result = {0};
+    int cluster_ret_value = -1;
+    struct rusage usage;
+    FILE * output;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:w:j:p:r:o:b:c:f:")) != -1) {
+        switch (option) {
+        case 'n':
+            n_workers = strtol(optarg, NULL, 10);
+            break;
+        case 'w':
+            window_ms = strtol(optarg, NULL, 10);
+            break;
+        case 'j':
+            n_clients = strtol(optarg, NULL, 10);
+            break;
+        case 'p':
+            pipeline = strtol(optarg, NULL, 10);
+            break;
+        case 'r':
+            n_records = strtol(optarg, NULL, 10);
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'b':
+            bin_dir = optarg;
+            break;
+        case 'c':
+            commit = optarg;
+            break;
+        case 'f':
+            build_flags = optarg;
+            break;
+        default:
+            flout_bench_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // One slot is kept free for the worker that joins during the cluster scenario.
+    if (n_workers < 0 || n_workers > MAX_CONNECTED_WORKERS - 1 || window_ms <= 0 || n_clients <= 0 || pipeline <= 0
+        || n_records <= 0) {
+        log_message(ERROR, log_name, "need 0 to %d workers, and a positive window, number of clients, pipeline "
+            "and number of records",
+            MAX_CONNECTED_WORKERS - 1);
+        return 1;
+    }
+
+    // Killed workers must not take the benchmark down with them.
+    signal(SIGPIPE, SIG_IGN);
+
+    flout_bench_keyed(n_records, n_workers, &keyed_result);
+    if (n_workers > 0) {
+        cluster_ret_value = flout_bench_cluster(bin_dir, n_workers, window_ms, n_clients, pipeline, &cluster_result);
+    }
+
+    output = fopen(output_path, "a");
+    if (output == NULL) {
+        log_message(ERROR, log_name, "could not open %s: %s", output_path, strerror(errno));
+        return 1;
+    }
+
+    // One line per run, so that results of many commits can be kept in one file.
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(output, "{\"commit\":");
+    flout_bench_write_json_string(output, commit);
+    fprintf(output, ",\"build_flags\":");
+    flout_bench_write_json_string(output, build_flags);
+    fprintf(output, ",\"timestamp\":%ld,\"workers\":%d,", (long) time(NULL), n_workers);
+    flout_bench_write_load_result(output, "keyed", &keyed_result);
+    if (cluster_ret_value == 0) {
+        fprintf(output, ",\"cluster\":{\"window_ms\":%ld,\"clients\":%d,\"pipeline\":%d,", cluster_result.window_ms,
+            cluster_result.n_clients, cluster_result.pipeline);
+        flout_bench_write_phase_result(output, "steady", &cluster_result.phases[FLOUT_BENCH_PHASE_STEADY], 0);
+        fprintf(output, ",");
+        flout_bench_write_phase_result(output, "grow", &cluster_result.phases[FLOUT_BENCH_PHASE_GROW], 1);
+        fprintf(output, ",");
+        flout_bench_write_phase_result(output, "shrink", &cluster_result.phases[FLOUT_BENCH_PHASE_SHRINK], 1);
+        fprintf(output, ",");
+        flout_bench_write_phase_result(output, "restart", &cluster_result.phases[FLOUT_BENCH_PHASE_RESTART], 0);
+        fprintf(output, ",\"redirects\":%ld,\"coordinator_cpu_ns_per_record\":%.1f,\"workers_cpu_ns_per_record\":%.1f,"
+            "\"coordinator_rss_kb\":%ld,\"worker_rss_kb\":%ld,\"key_groups\":%d}", cluster_result.n_redirects,
+            cluster_result.coordinator_cpu_ns_per_record, cluster_result.workers_cpu_ns_per_record,
+            cluster_result.coordinator_rss_kb, cluster_result.workers_rss_kb, FLOUT_KEY_GROUPS);
+    }
+    fprintf(output, ",\"bench_max_rss_kb\":%ld}\n", usage.ru_maxrss);
+    fclose(output);
+
+    log_message(INFO, log_name, "results appended to %s", output_path);
+
+    return cluster_ret_value < 0 && n_workers > 0 ? 1 : 0;
+}
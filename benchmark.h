@@ -0,0 +1,176 @@
+#ifndef FLOUT_BENCHMARK_H_INCLUDED
+#define FLOUT_BENCHMARK_H_INCLUDED
+
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coordinator.h"
+#include "utils/err.h"
+#include "utils/keygroups.h"
+#include "utils/log.h"
+#include "utils/net.h"
+#include "utils/rpc.h"
+#include "utils/threading.h"
+
+// Ports used by the local cluster, matching coordinator and worker defaults.
+#define FLOUT_BENCH_FIRST_WORKER_PORT 8123
+
+// How long to wait for the coordinator to rescale, or for a record to find an owner, before giving up.
+#define FLOUT_BENCH_RESCALE_TIMEOUT_MS 15000
+
+// How long to keep trying to connect to a worker's data endpoint after starting it.
+#define FLOUT_BENCH_CONNECT_TIMEOUT_MS 5000
+
+// Records processed in-process are timed in batches of this size,
+// since a single record takes less time than reading the clock.
+#define FLOUT_BENCH_BATCH_SIZE 1024
+
+// Resident set size of cluster processes is sampled this often while under steady load.
+#define FLOUT_BENCH_RSS_SAMPLE_INTERVAL_MS 200
+
+// A record refused by every connected worker belongs to a key group that has no owner at the moment,
+// and is sent again after this long.
+#define FLOUT_BENCH_RETRY_INTERVAL_MS 1
+
+// How long the load thread waits for replies before checking for new connections and being stopped.
+#define FLOUT_BENCH_POLL_INTERVAL_MS 10
+
+// Phases of the cluster scenario, each measured over its own window while load keeps running:
+// steady state, a worker joining, a worker crashing, and killing and restarting every process.
+#define FLOUT_BENCH_PHASE_NONE -1
+#define FLOUT_BENCH_PHASE_STEADY 0
+#define FLOUT_BENCH_PHASE_GROW 1
+#define FLOUT_BENCH_PHASE_SHRINK 2
+#define FLOUT_BENCH_PHASE_RESTART 3
+#define FLOUT_BENCH_PHASES 4
+
+// Splits output of a child process, read through a pipe, into lines.
+typedef struct {
+    int fd;
+    char buffer[4096];
+    size_t length;
+} flout_bench_line_reader_t;
+
+// Processes of a local cluster. Workers are indexed by their position on the host, which decides their port,
+// and have a PID of 0 when not running.
+typedef struct {
+    char coordinator_path[256];
+    char worker_path[256];
+    pid_t coordinator_pid;
+    pid_t worker_pids[MAX_CONNECTED_WORKERS];
+    flout_bench_line_reader_t coordinator_log;
+    int null_fd;
+} flout_bench_cluster_t;
+
+// A record sent, or about to be sent, by a client. start_ns is when it has been issued, so that time spent
+// being redirected, or waiting for its key group to get an owner, counts towards its latency.
+// worker is the worker it has been sent to, or last refused by, or -1 if it hasn't been sent yet.
+typedef struct {
+    uint64_t key;
+    long sequence;
+    long start_ns;
+    long retry_ns;
+    int worker;
+    int n_refusals;
+    int in_flight;
+} flout_bench_record_t;
+
+// Sends records to workers' data endpoints, indexed the same way as in flout_bench_cluster_t,
+// keeping pipeline records in flight at once. Workers reply to records in the order they have been sent,
+// so records in flight on each connection are kept in a queue of record indices.
+// Remembers which worker has last processed each key group, and tries the others when it's been moved.
+typedef struct {
+    int socket_fds[MAX_CONNECTED_WORKERS];
+    int routes[FLOUT_KEY_GROUPS];
+    long sequence;
+    long n_redirects;
+    int pipeline;
+    flout_bench_record_t * records;
+    int * in_flight[MAX_CONNECTED_WORKERS];
+    int in_flight_head[MAX_CONNECTED_WORKERS];
+    int n_in_flight[MAX_CONNECTED_WORKERS];
+} flout_bench_client_t;
+
+// Results of a load-driven scenario, measured over n_records records.
+// Latency percentiles are per batch of batch_size records.
+typedef struct {
+    long n_records;
+    long batch_size;
+    double throughput_per_s;
+    double p50_us;
+    double p99_us;
+    double p999_us;
+    double max_us;
+    double cpu_ns_per_record;
+} flout_bench_load_result_t;
+
+// A rescaling as reported by the coordinator itself: the number of key groups it has moved,
+// those left without an owner, and how long it has taken to hand them over.
+typedef struct {
+    int n_workers;
+    int moved_key_groups;
+    int n_unassigned;
+    long duration_us;
+} flout_bench_rescale_t;
+
+// Shared by the load thread and the main thread, which sets phase and stop.
+// last_progress_ns is when a record has last been processed, and no_progress_ns
+// the longest time in each phase without any record being processed.
+typedef struct {
+    atomic_int phase;
+    atomic_int stop;
+    atomic_long last_progress_ns;
+    atomic_long no_progress_ns[FLOUT_BENCH_PHASES];
+} flout_bench_load_control_t;
+
+// Load of a single client, which keeps sending records to the cluster on its own thread over its own connections,
+// and collects their latencies for the phase in which each of them has been processed. A record is retried until some worker processes it.
+// The client is only used by the load thread; new connections are handed over to it through pending_fds
+// (-1 when there is none).
+typedef struct {
+    flout_bench_load_control_t * control;
+    flout_bench_client_t client;
+    atomic_int pending_fds[MAX_CONNECTED_WORKERS];
+    uint64_t key_state;
+    long * latencies_ns[FLOUT_BENCH_PHASES];
+    long n_records[FLOUT_BENCH_PHASES];
+    long capacity[FLOUT_BENCH_PHASES];
+} flout_bench_load_t;
+
+// Results of a phase of the cluster scenario. rescale is the coordinator's last rescaling in the phase, if any,
+// and rescale_us the time from the change of membership until every key group has had an owner again.
+typedef struct {
+    flout_bench_load_result_t load;
+    flout_bench_rescale_t rescale;
+    long rescale_us;
+    double no_progress_ms;
+    long duration_ms;
+} flout_bench_phase_result_t;
+
+// Results of the cluster scenario.
+// CPU time per record and RSS are those of the cluster processes under steady load, not of the benchmark.
+typedef struct {
+    int n_workers;
+    int n_clients;
+    int pipeline;
+    long window_ms;
+    flout_bench_phase_result_t phases[FLOUT_BENCH_PHASES];
+    long n_redirects;
+    double coordinator_cpu_ns_per_record;
+    double workers_cpu_ns_per_record;
+    long coordinator_rss_kb;
+    long workers_rss_kb;
+} flout_bench_cluster_result_t;
+
+#endif
@@ -4,10 +4,26 @@
 // before it gets disconnected from this coordinator.
 const int worker_timeout_ms = 5000;
 
+// Max time between two rounds of the comms thread, when no worker sends anything or joins in the meantime.
+const int comms_interval_ms = 1000;
+
 // Open connections to workers are being stored here.
 // Free slots are set to zero.
 flout_worker_slot_t connected_workers[MAX_CONNECTED_WORKERS];
 
+// Worker ID owning each key group, or -1 if the key group is unassigned.
+int key_group_owners[FLOUT_KEY_GROUPS];
+
+// Set whenever a worker joins or leaves, so that key groups get redistributed.
+// Guarded by membership_lock, since workers join on the registration thread.
+// Slots of connected_workers are also filled and freed under it.
+int membership_changed = 0;
+pthread_mutex_t membership_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Written to by the registration thread whenever a worker joins, so that the comms thread wakes up and rescales
+// right away, rather than on its next round.
+int wakeup_pipe_fds[2] = {-1, -1};
+
 
 /**
  * Initialize global state.
@@ -19,6 +35,14 @@ void flout_coordinator_init()
     for (i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
         connected_workers[i].status = SFLOUT_FREE;
     }
+
+    for (i = 0; i < FLOUT_KEY_GROUPS; ++i) {
+        key_group_owners[i] = -1;
+    }
+
+    if (pipe(wakeup_pipe_fds) == 0) {
+        fcntl(wakeup_pipe_fds[0], F_SETFL, fcntl(wakeup_pipe_fds[0], F_GETFL, 0) | O_NONBLOCK);
+    }
 }
 
 
@@ -38,6 +62,11 @@ int flout_register_worker(int worker_rpc_socket_fd, char * char_buffer, const si
 
     log_message(INFO, log_name, "registering worker");
 
+    // The slot is found, filled and published under membership_lock, so that it can't be freed by the comms thread
+    // in the meantime, and the worker's key groups are never reassigned halfway through its registration.
+    // The response is a single message on a fresh connection, so it never has to wait for the socket.
+    pthread_mutex_lock(&membership_lock);
+
     // Find a free spot in the connection queue and fill it with incoming connection data.
     for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
         if (connected_workers[i].status == SFLOUT_FREE) {
@@ -51,8 +80,9 @@ int flout_register_worker(int worker_rpc_socket_fd, char * char_buffer, const si
         // Could not find a free slot, so we close the connection without acknowledgment.
         log_message(ERROR, log_name, "no free slot found, could not register worker");
         snprintf(char_buffer, char_buffer_size, "%d", EFLOUT_NOFREESLOT);
-        write(worker_rpc_socket_fd, char_buffer, char_buffer_size);
+        flout_rpc_send(worker_rpc_socket_fd, char_buffer);
         close(worker_rpc_socket_fd);
+        pthread_mutex_unlock(&membership_lock);
         return -1;
     }
 
@@ -61,11 +91,12 @@ int flout_register_worker(int worker_rpc_socket_fd, char * char_buffer, const si
     // Acknowledge the request by sending worker ID,
     // which is its position in the connected_workers array.
     snprintf(char_buffer, char_buffer_size, "%d", found_slot_id);
-    if (write(worker_rpc_socket_fd, char_buffer, strlen(char_buffer)) < 0) {
+    if (flout_rpc_send(worker_rpc_socket_fd, char_buffer) < 0) {
         // If we could not respond with an acknowledgement,
         // then the connection won't be established.
         log_message(ERROR, log_name, "could not write connection response: %s", strerror(errno));
         close(worker_rpc_socket_fd);
+        pthread_mutex_unlock(&membership_lock);
         return -1;
     }
 
@@ -74,42 +105,86 @@ int flout_register_worker(int worker_rpc_socket_fd, char * char_buffer, const si
     found_slot->socket_fd = worker_rpc_socket_fd;
     found_slot->last_activity_ts = get_current_time_ms();
     found_slot->status = SFLOUT_OCCUPIED;
+
+    // The new worker will take over its share of key groups on the next rescaling.
+    membership_changed = 1;
+
+    pthread_mutex_unlock(&membership_lock);
     log_message(INFO, log_name, "connected to worker %d", found_slot_id);
 
+    write(wakeup_pipe_fds[1], "w", 1);
+
     return worker_rpc_socket_fd;
 }
 
 
+/**
+ * Close the connection to a worker and free its slot.
+ *
+ * Key groups owned by the worker are marked as unassigned before the slot is freed,
+ * so that a new worker registering into the same slot doesn't inherit them without being told to acquire them,
+ * and never gets commands meant for its predecessor.
+ */
+void flout_disconnect_worker(const int worker_id, flout_worker_slot_t * worker_slot)
+{
+    pthread_mutex_lock(&membership_lock);
+
+    for (int kg = 0; kg < FLOUT_KEY_GROUPS; ++kg) {
+        if (key_group_owners[kg] == worker_id) {
+            key_group_owners[kg] = -1;
+        }
+    }
+    close(worker_slot->socket_fd);
+    worker_slot->status = SFLOUT_FREE;
+    membership_changed = 1;
+
+    pthread_mutex_unlock(&membership_lock);
+}
+
+
 /**
  * Handle incoming RPC calls from worker. This function polls on a worker socket,
  * accepts RPC invocations and calls local methods with given parameters.
+ * buffer must fit at least FLOUT_RPC_MSG_SIZE bytes.
+ * Returns the number of messages handled, or -1 if the connection has failed or been closed.
  */
 int flout_handle_rpc(const int worker_id, flout_worker_slot_t * worker_slot, char * buffer, size_t buffer_size)
 {
     const char * log_name = "flout_handle_rpc";
 
     int ret_code = flout_check_socket_read(worker_slot->socket_fd, 0);
+    int n_messages = 0;
 
     if (ret_code != 0) {
 
         log_message(INFO, log_name, "received commands from worker %d", worker_id);
 
-        if (read(worker_slot->socket_fd, buffer, buffer_size) < 0) {
+        // Handle every complete message that has arrived; the socket is non-blocking.
+        while ((ret_code = flout_rpc_recv(worker_slot->socket_fd, buffer)) == 0) {
+            buffer[FLOUT_RPC_MSG_SIZE-1] = '\0';
+            if (buffer[0] != FLOUT_RPC_CMD_HEARTBEAT) {
+                log_message(WARN, log_name, "ignoring unknown command from worker %d: %s", worker_id, buffer);
+            }
+            ++n_messages;
+        }
+
+        if (ret_code < 0) {
+            // A closed connection must not count as activity.
             log_message(ERROR, log_name, "failed to fetch commands from worker %d: %s",
                 worker_id, strerror(errno));
             return -1;
         }
 
         // Mark this worker as alive.
-        worker_slot->last_activity_ts = get_current_time_ms();
-
-        // There are no known commands yet, so finish for now.
+        if (n_messages > 0) {
+            worker_slot->last_activity_ts = get_current_time_ms();
+        }
     }
     else {
         log_message(INFO, log_name, "no commands from worker %d", worker_id);
     }
 
-    return 0;
+    return n_messages;
 }
 
 /**
@@ -132,12 +207,153 @@ int flout_handle_liveness(const int worker_id, flout_worker_slot_t * worker_slot
 
     // Otherwise, the connection is closed and the slot is freed.
     log_message(INFO, log_name, "worker %d is gone, last activity was %d ms ago, disconnecting", worker_id, delta);
-    close(worker_slot->socket_fd);
-    worker_slot->status = SFLOUT_FREE;
+    flout_disconnect_worker(worker_id, worker_slot);
     return 1;
 }
 
 
+/**
+ * Wait for a worker to confirm that it has released key_group, and store the state it sends back into state.
+ * Heartbeats arriving in the meantime count as activity, as they do in flout_handle_rpc().
+ * Returns 0 on success, or -1 if the connection has failed or the worker hasn't confirmed
+ * within FLOUT_RPC_TIMEOUT_MS (errno set to ETIMEDOUT).
+ */
+int flout_await_release(const int worker_id, flout_worker_slot_t * worker_slot, const int key_group, long * state)
+{
+    const char * log_name = "flout_await_release";
+
+    char message[FLOUT_RPC_MSG_SIZE];
+    struct pollfd pollfds[1];
+    time_t deadline_ms = get_current_time_ms() + FLOUT_RPC_TIMEOUT_MS;
+    time_t remaining_ms;
+    char command;
+    int released_key_group;
+    int ret_value;
+
+    pollfds[0].fd = worker_slot->socket_fd;
+    pollfds[0].events = POLLIN;
+
+    while (1) {
+        ret_value = flout_rpc_recv(worker_slot->socket_fd, message);
+        if (ret_value < 0) {
+            return -1;
+        }
+        if (ret_value > 0) {
+            // Nothing has arrived yet; the socket is non-blocking.
+            remaining_ms = deadline_ms - get_current_time_ms();
+            if (remaining_ms <= 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            poll(pollfds, 1, remaining_ms);
+            continue;
+        }
+
+        message[FLOUT_RPC_MSG_SIZE-1] = '\0';
+        worker_slot->last_activity_ts = get_current_time_ms();
+        if (sscanf(message, "%c %d %ld", &command, &released_key_group, state) == 3
+            && command == FLOUT_RPC_CMD_RELEASED && released_key_group == key_group) {
+            return 0;
+        }
+        if (message[0] != FLOUT_RPC_CMD_HEARTBEAT) {
+            log_message(WARN, log_name, "ignoring unexpected message from worker %d: %s", worker_id, message);
+        }
+    }
+}
+
+
+/**
+ * Redistribute key groups over currently connected workers without restarting the job.
+ *
+ * Key groups are assigned with consistent hashing, so only the key groups whose owner has changed
+ * are moved, and only their state is transferred. Each of them is handed over in three steps:
+ * the previous owner is told to release it, and answers with its state once it has stopped processing it;
+ * only then is the new owner told to acquire it, along with that state and the ID of the previous owner.
+ * This way no two workers ever process the same key group at once.
+ * The previous owner is -1 if the key group was unassigned or its owner is gone, in which case
+ * the key group starts over with empty state, as there are no checkpoints to restore it from yet.
+ * Key groups that stay on the same worker are not touched at all.
+ * Workers that can't be sent a command, or don't confirm a release in time, are disconnected,
+ * which triggers another rescaling.
+ * Returns the number of key groups that have been moved.
+ */
+int flout_rescale_key_groups()
+{
+    const char * log_name = "flout_rescale_key_groups";
+
+    int worker_ids[MAX_CONNECTED_WORKERS];
+    int n_workers = 0;
+    int new_owners[FLOUT_KEY_GROUPS];
+    int n_moved = 0;
+    int n_unassigned = 0;
+    int old_owner, new_owner;
+    long state;
+    char message[FLOUT_RPC_MSG_SIZE];
+    long start_ts = get_current_time_us();
+
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        if (connected_workers[i].status == SFLOUT_OCCUPIED) {
+            worker_ids[n_workers++] = i;
+        }
+    }
+
+    flout_assign_key_groups(worker_ids, n_workers, new_owners);
+
+    for (int kg = 0; kg < FLOUT_KEY_GROUPS; ++kg) {
+        old_owner = key_group_owners[kg];
+        new_owner = new_owners[kg];
+        if (old_owner == new_owner) {
+            continue;
+        }
+
+        state = 0;
+        if (old_owner >= 0 && connected_workers[old_owner].status == SFLOUT_OCCUPIED) {
+            memset(message, 0, sizeof(message));
+            snprintf(message, sizeof(message), "%c %d", FLOUT_RPC_CMD_RELEASE, kg);
+            if (flout_rpc_send(connected_workers[old_owner].socket_fd, message) < 0
+                || flout_await_release(old_owner, &connected_workers[old_owner], kg, &state) < 0) {
+                log_message(ERROR, log_name, "could not release key group %d from worker %d: %s, disconnecting",
+                    kg, old_owner, strerror(errno));
+                flout_disconnect_worker(old_owner, &connected_workers[old_owner]);
+                old_owner = -1;
+                state = 0;
+            }
+        }
+
+        if (new_owner >= 0 && connected_workers[new_owner].status == SFLOUT_OCCUPIED) {
+            memset(message, 0, sizeof(message));
+            snprintf(message, sizeof(message), "%c %d %d %ld", FLOUT_RPC_CMD_ACQUIRE, kg, old_owner, state);
+            if (flout_rpc_send(connected_workers[new_owner].socket_fd, message) < 0) {
+                log_message(ERROR, log_name, "could not assign key group %d to worker %d: %s, disconnecting",
+                    kg, new_owner, strerror(errno));
+                flout_disconnect_worker(new_owner, &connected_workers[new_owner]);
+                new_owner = -1;
+            }
+        }
+        else {
+            // No workers are left, or the new owner has just been disconnected;
+            // either way the key group is handed out on the next rescaling.
+            new_owner = -1;
+        }
+
+        key_group_owners[kg] = new_owner;
+        ++n_moved;
+    }
+
+    // Key groups whose new owner has failed stay unassigned until the next rescaling.
+    for (int kg = 0; kg < FLOUT_KEY_GROUPS; ++kg) {
+        if (key_group_owners[kg] < 0) {
+            ++n_unassigned;
+        }
+    }
+
+    log_message(INFO, log_name, "rescaled onto %d workers: moved %d of %d key groups in %ld us, %d unassigned",
+        n_workers, n_moved, FLOUT_KEY_GROUPS, get_current_time_us() - start_ts, n_unassigned);
+
+    return n_moved;
+}
+
+
 /**
  * Body of a thread that handles registrations only.
  * 
@@ -169,6 +385,9 @@ void * flout_coordinator_registration_thread_fn(void *msg)
         return NULL;
     }
 
+    flout_parse_address(server_addr, char_buffer, char_buffer_size);
+    log_message(INFO, log_name, "accepting worker registrations at %s", char_buffer);
+
     struct sockaddr_in6 addr_buffer = {0};
     socklen_t addr_buffer_size = sizeof(addr_buffer);
     flout_worker_slot_t * worker_slot;
@@ -190,7 +409,7 @@ void * flout_coordinator_registration_thread_fn(void *msg)
         }
 
         flout_parse_address(&addr_buffer, char_buffer, INET6_ADDRSTRLEN);
-        log_message(INFO, log_name, "opening connection to a worker at %s", addr_buffer);
+        log_message(INFO, log_name, "opening connection to a worker at %s", char_buffer);
 
         flout_register_worker(worker_rpc_socket_fd, char_buffer, char_buffer_size,
             (struct sockaddr *) &addr_buffer, addr_buffer_size);
@@ -200,6 +419,33 @@ void * flout_coordinator_registration_thread_fn(void *msg)
 }
 
 
+/**
+ * Wait until a connected worker sends something or disconnects, a worker registers, or timeout_ms pass,
+ * so that changes of membership are noticed as soon as they happen.
+ */
+void flout_wait_for_workers(const int timeout_ms)
+{
+    struct pollfd pollfds[MAX_CONNECTED_WORKERS + 1];
+    char wakeup_buffer[64];
+    int n_polled = 0;
+
+    pollfds[n_polled].fd = wakeup_pipe_fds[0];
+    pollfds[n_polled++].events = POLLIN;
+    for (int i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
+        if (connected_workers[i].status == SFLOUT_OCCUPIED) {
+            pollfds[n_polled].fd = connected_workers[i].socket_fd;
+            pollfds[n_polled++].events = POLLIN;
+        }
+    }
+
+    poll(pollfds, n_polled, timeout_ms);
+
+    // Registrations that have woken us up are handled in this round, so the next wait mustn't return right away.
+    while (read(wakeup_pipe_fds[0], wakeup_buffer, sizeof(wakeup_buffer)) > 0) {
+    }
+}
+
+
 /**
  * All communication with workers is being handled here.
  */
@@ -210,6 +456,7 @@ void * flout_coordinator_comms_thread_fn(void * msg)
     flout_worker_slot_t * worker_slot;
     const int char_buffer_size = 1024;
     char char_buffer[char_buffer_size];
+    int rescale;
     int i;
 
     while (1) {
@@ -217,11 +464,25 @@ void * flout_coordinator_comms_thread_fn(void * msg)
         for (i = 0; i < MAX_CONNECTED_WORKERS; ++i) {
             if (connected_workers[i].status == SFLOUT_OCCUPIED) {
                 worker_slot = &connected_workers[i];
-                flout_handle_rpc(i, worker_slot, char_buffer, char_buffer_size);
+                // A worker whose connection has failed is gone for good, no need to wait for it to time out.
+                if (flout_handle_rpc(i, worker_slot, char_buffer, char_buffer_size) < 0) {
+                    log_message(INFO, log_name, "worker %d has been lost, disconnecting", i);
+                    flout_disconnect_worker(i, worker_slot);
+                    continue;
+                }
                 flout_handle_liveness(i, worker_slot, worker_timeout_ms);
             }
         }
-        sleep(1);
+
+        // Grow onto newly registered workers and shrink off departed ones.
+        pthread_mutex_lock(&membership_lock);
+        rescale = membership_changed;
+        membership_changed = 0;
+        pthread_mutex_unlock(&membership_lock);
+        if (rescale) {
+            flout_rescale_key_groups();
+        }
+        flout_wait_for_workers(comms_interval_ms);
     }
 }
 
@@ -268,6 +529,9 @@ void * flout_coordinator_ui_thread_fn(void * msg)
 
 int main(int argc, char* argv[])
 {
+    // Writes to a worker that has just gone away must not kill the coordinator.
+    signal(SIGPIPE, SIG_IGN);
+
     flout_coordinator_init();
 
     struct sockaddr_in6 registration_addr;
@@ -1,20 +1,26 @@
 #ifndef FLOUT_COORDINATOR_H_INCLUDED
 #define FLOUT_COORDINATOR_H_INCLUDED
 
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "utils/err.h"
+#include "utils/keygroups.h"
 #include "utils/log.h"
 #include "utils/net.h"
+#include "utils/rpc.h"
 #include "utils/threading.h"
 
 #define MAX_CONNECTED_WORKERS 8
 
+// status is written by the registration thread when a worker joins, and by the comms thread when it leaves,
+// so it's atomic; a slot's other fields are filled in before it's marked as occupied.
 typedef struct {
-    int status;
+    atomic_int status;
     int socket_fd;
     suseconds_t last_activity_ts;
 } flout_worker_slot_t;
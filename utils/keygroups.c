@@ -0,0 +1,107 @@
+#include "keygroups.h"
+
+
+/**
+ * 32-bit FNV-1a hash of size bytes of data, followed by a finalizer
+ * that spreads the bits of short inputs (such as single integers) over the whole range.
+ */
+uint32_t flout_hash(const void * data, const size_t size)
+{
+    const unsigned char * bytes = (const unsigned char *) data;
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+
+/**
+ * Get the key group that a key of key_size bytes belongs to.
+ */
+int flout_key_group_of(const void * key, const size_t key_size)
+{
+    return flout_hash(key, key_size) % FLOUT_KEY_GROUPS;
+}
+
+
+static int flout_compare_ring_points(const void * a, const void * b)
+{
+    const flout_ring_point_t * point_a = (const flout_ring_point_t *) a;
+    const flout_ring_point_t * point_b = (const flout_ring_point_t *) b;
+
+    if (point_a->hash != point_b->hash) {
+        return point_a->hash < point_b->hash ? -1 : 1;
+    }
+    return point_a->worker_id - point_b->worker_id;
+}
+
+
+/**
+ * Assign every key group to one of n_workers workers using consistent hashing,
+ * and write the owner's worker ID for each key group into owners (FLOUT_KEY_GROUPS entries).
+ *
+ * Each worker is placed on a hash ring at FLOUT_RING_POINTS_PER_WORKER points derived from its ID,
+ * and a key group belongs to the first worker point at or after the key group's own hash.
+ * When a worker joins, it only takes key groups over from others, and when a worker leaves,
+ * only its own key groups are handed out - all other assignments stay where they were.
+ *
+ * If there are no workers, all key groups are left unassigned (-1).
+ * Returns the number of workers placed on the ring.
+ */
+int flout_assign_key_groups(const int * worker_ids, const int n_workers, int * owners)
+{
+    flout_ring_point_t ring[FLOUT_RING_MAX_WORKERS * FLOUT_RING_POINTS_PER_WORKER];
+    int n_points = 0;
+    int n_placed = n_workers < FLOUT_RING_MAX_WORKERS ? n_workers : FLOUT_RING_MAX_WORKERS;
+    int point_key[2];
+    int low, high, mid;
+    uint32_t key_group_hash;
+
+    if (n_placed <= 0) {
+        for (int kg = 0; kg < FLOUT_KEY_GROUPS; ++kg) {
+            owners[kg] = -1;
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < n_placed; ++i) {
+        for (int p = 0; p < FLOUT_RING_POINTS_PER_WORKER; ++p) {
+            point_key[0] = worker_ids[i];
+            point_key[1] = p;
+            ring[n_points].hash = flout_hash(point_key, sizeof(point_key));
+            ring[n_points].worker_id = worker_ids[i];
+            ++n_points;
+        }
+    }
+    qsort(ring, n_points, sizeof(flout_ring_point_t), flout_compare_ring_points);
+
+    for (int kg = 0; kg < FLOUT_KEY_GROUPS; ++kg) {
+        key_group_hash = flout_hash(&kg, sizeof(kg));
+
+        // Binary search for the first point with hash >= key_group_hash, wrapping around the ring.
+        low = 0;
+        high = n_points;
+        while (low < high) {
+            mid = low + (high - low) / 2;
+            if (ring[mid].hash < key_group_hash) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+        owners[kg] = ring[low % n_points].worker_id;
+    }
+
+    return n_placed;
+}
@@ -0,0 +1,28 @@
+#ifndef FLOUT_UTIL__KEYGROUPS_H_INCLUDED
+#define FLOUT_UTIL__KEYGROUPS_H_INCLUDED
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Keys are hashed into a fixed number of key groups, which are the unit of
+// work (and state) that gets moved between workers when the cluster is rescaled.
+#define FLOUT_KEY_GROUPS 128
+
+// Number of points each worker occupies on the hash ring.
+// More points mean a more even spread of key groups between workers.
+#define FLOUT_RING_POINTS_PER_WORKER 32
+
+// Upper bound on the number of workers that can be placed on the ring.
+#define FLOUT_RING_MAX_WORKERS 64
+
+typedef struct {
+    uint32_t hash;
+    int worker_id;
+} flout_ring_point_t;
+
+uint32_t flout_hash(const void * data, const size_t size);
+int flout_key_group_of(const void * key, const size_t key_size);
+int flout_assign_key_groups(const int * worker_ids, const int n_workers, int * owners);
+
+#endif
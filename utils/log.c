@@ -47,4 +47,7 @@ void log_message(enum log_level log_level, const char *caller_name, const char *
     vprintf(format, argp);
     va_end(argp);
     printf("\n");
+
+    // Flush every line, so that logs are not lost on kill and can be followed through a pipe.
+    fflush(stdout);
 }
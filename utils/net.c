@@ -52,6 +52,9 @@ int flout_create_outbound_socket(struct sockaddr * server_addr, const int queue_
 
     int socket_fd;
     int ret_code;
+    int saved_errno;
+    const int reuse_addr = 1;
+    char address_buffer[INET6_ADDRSTRLEN + 8];
 
     // Set up an outbound socket to communicate with workers requesting registration.
     socket_fd = socket(AF_INET6, SOCK_STREAM, 0);
@@ -59,17 +62,26 @@ int flout_create_outbound_socket(struct sockaddr * server_addr, const int queue_
         snprintf(err_buf, err_buf_len, "outbound socket creation failed: %s", strerror(errno));
         return socket_fd;
     }
+    // Allow rebinding right after a restart, while old connections are still in TIME_WAIT.
+    setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr));
+
     ret_code = bind(socket_fd, server_addr, sizeof(struct sockaddr_in6));
     if (ret_code < 0) {
-        snprintf(err_buf, err_buf_len, "outbound socket failed to bind at %s: %s", server_addr, strerror(errno));
+        saved_errno = errno;
+        flout_parse_address((struct sockaddr_in6 *) server_addr, address_buffer, sizeof(address_buffer));
+        snprintf(err_buf, err_buf_len, "outbound socket failed to bind at %s: %s", address_buffer, strerror(saved_errno));
         close(socket_fd);
+        errno = saved_errno;
         return ret_code;
     }
 
     ret_code = listen(socket_fd, queue_size);
     if (ret_code < 0) {
-        snprintf(err_buf, err_buf_len, "listening on %s failed: %s", server_addr, strerror(errno));
+        saved_errno = errno;
+        flout_parse_address((struct sockaddr_in6 *) server_addr, address_buffer, sizeof(address_buffer));
+        snprintf(err_buf, err_buf_len, "listening on %s failed: %s", address_buffer, strerror(saved_errno));
         close(socket_fd);
+        errno = saved_errno;
         return ret_code;
     }
 
@@ -0,0 +1,94 @@
+#include "rpc.h"
+
+
+/**
+ * Wait until the socket is ready for events, for at most FLOUT_RPC_TIMEOUT_MS.
+ * Returns 0 when ready, or -1 on failure or timeout, with errno set to ETIMEDOUT in the latter case.
+ */
+static int flout_rpc_wait(const int socket_fd, const short events)
+{
+    struct pollfd pollfds[1];
+    int ret_value;
+
+    pollfds[0].fd = socket_fd;
+    pollfds[0].events = events;
+
+    do {
+        ret_value = poll(pollfds, 1, FLOUT_RPC_TIMEOUT_MS);
+    } while (ret_value < 0 && errno == EINTR);
+
+    if (ret_value == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return ret_value < 0 ? -1 : 0;
+}
+
+
+/**
+ * Write a single message of FLOUT_RPC_MSG_SIZE bytes from buffer to the socket.
+ * Returns 0 on success or -1 on failure, with errno set by write(),
+ * or to ETIMEDOUT if the peer has not made room for the message in time.
+ */
+int flout_rpc_send(const int socket_fd, const char * buffer)
+{
+    size_t n_written = 0;
+    ssize_t ret_value;
+
+    while (n_written < FLOUT_RPC_MSG_SIZE) {
+        ret_value = write(socket_fd, buffer + n_written, FLOUT_RPC_MSG_SIZE - n_written);
+        if (ret_value < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Non-blocking sockets may be momentarily full, so wait until there is room.
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && flout_rpc_wait(socket_fd, POLLOUT) == 0) {
+                continue;
+            }
+            return -1;
+        }
+        n_written += ret_value;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Read a single message of FLOUT_RPC_MSG_SIZE bytes from the socket into buffer.
+ * Returns 0 on success, 1 if nothing has arrived before the socket timeout,
+ * or -1 on failure or when the peer has closed the connection (errno set to ECONNRESET).
+ * Once the first byte of a message has been read, the rest is waited for (up to FLOUT_RPC_TIMEOUT_MS),
+ * so that the stream never gets out of sync.
+ */
+int flout_rpc_recv(const int socket_fd, char * buffer)
+{
+    size_t n_read = 0;
+    ssize_t ret_value;
+
+    while (n_read < FLOUT_RPC_MSG_SIZE) {
+        ret_value = read(socket_fd, buffer + n_read, FLOUT_RPC_MSG_SIZE - n_read);
+        if (ret_value == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (ret_value < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (n_read == 0) {
+                    return 1;
+                }
+                if (flout_rpc_wait(socket_fd, POLLIN) == 0) {
+                    continue;
+                }
+                return -1;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        n_read += ret_value;
+    }
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef FLOUT_UTIL__RPC_H_INCLUDED
+#define FLOUT_UTIL__RPC_H_INCLUDED
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+// All messages exchanged over the RPC connection between the coordinator and a worker
+// have this exact size, so that consecutive messages can't be read as one.
+#define FLOUT_RPC_MSG_SIZE 32
+
+// How long to wait for a peer to make room for, or finish sending, a message.
+// A peer that takes longer is treated as gone, so it can't stall the caller.
+#define FLOUT_RPC_TIMEOUT_MS 1000
+
+// Commands sent by workers to the coordinator.
+// Heartbeat: "H <worker ID>"
+// Released, with the state of the key group as it was when the worker stopped processing it: "S <key group> <state>"
+#define FLOUT_RPC_CMD_HEARTBEAT 'H'
+#define FLOUT_RPC_CMD_RELEASED 'S'
+
+// Commands sent by the coordinator to workers.
+// Acquire, with the state to resume the key group from: "A <key group> <previous owner or -1> <state>"
+// Release, to be answered with Released: "R <key group>"
+#define FLOUT_RPC_CMD_ACQUIRE 'A'
+#define FLOUT_RPC_CMD_RELEASE 'R'
+
+// Records sent by clients to a worker's data endpoint, and the worker's replies.
+// Record: "D <sequence number> <key>"
+// Processed: "K <sequence number>"
+// Not processed, because the worker doesn't own the key's group: "N <sequence number>"
+#define FLOUT_RPC_CMD_RECORD 'D'
+#define FLOUT_RPC_CMD_PROCESSED 'K'
+#define FLOUT_RPC_CMD_NOT_OWNER 'N'
+
+int flout_rpc_send(const int socket_fd, const char * buffer);
+int flout_rpc_recv(const int socket_fd, char * buffer);
+
+#endif
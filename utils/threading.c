@@ -9,3 +9,13 @@ time_t get_current_time_ms() {
     gettimeofday(&tv, NULL);
     return (tv.tv_sec) * 1000 + (long) ((tv.tv_usec) / 1000);
 }
+
+
+/**
+ * Get the current time in microseconds, for timing short operations.
+ */
+long get_current_time_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000L + tv.tv_usec;
+}
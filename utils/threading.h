@@ -5,5 +5,6 @@
 #include <sys/time.h>
 
 suseconds_t get_current_time_ms();
+long get_current_time_us();
 
 #endif
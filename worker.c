@@ -7,10 +7,41 @@
 
 // Sockets which are supposed to be open during worker lifetime.
 int rpc_socket_fd = -1;
+int data_socket_fd = -1;
 
 // Worker ID as obtained from the coordinator.
 int worker_id = -1;
 
+// Key groups currently processed by this worker, as assigned by the coordinator.
+// Non-zero entries are owned.
+unsigned char owned_key_groups[FLOUT_KEY_GROUPS];
+
+// State of the keyed operator: a running sum of record values per key group.
+long key_group_state[FLOUT_KEY_GROUPS];
+
+// Guards owned_key_groups and key_group_state, shared by the rpc thread and data connections.
+pthread_mutex_t key_groups_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Serializes messages to the coordinator, which are sent by both the heartbeat and the rpc thread,
+// so that they can't get interleaved on the socket.
+pthread_mutex_t rpc_send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Send a single message to the coordinator.
+ * Returns 0 on success or -1 on failure, as flout_rpc_send() does.
+ */
+int flout_worker_send(const char * message)
+{
+    int ret_value;
+
+    pthread_mutex_lock(&rpc_send_lock);
+    ret_value = flout_rpc_send(rpc_socket_fd, message);
+    pthread_mutex_unlock(&rpc_send_lock);
+
+    return ret_value;
+}
+
 
 /**
  * Keeps the connection with coordinator up by periodically sending a heartbeat.
@@ -21,18 +52,17 @@ void * flout_worker_heartbeat_fn(void * msg)
 
     log_message(INFO, log_name, "initializing heartbeat thread");
 
-    const int char_buffer_size = 32;
-    char char_buffer[32];
+    char char_buffer[FLOUT_RPC_MSG_SIZE] = {0};
 
     flout_worker_heartbeat_fn_params * params = (flout_worker_heartbeat_fn_params *) msg;
 
     // For now, we'll use sleep() that has a full seconds precision.
     time_t interval_s = params->interval.tv_sec;
-    snprintf(char_buffer, char_buffer_size, "%d", worker_id);
+    snprintf(char_buffer, FLOUT_RPC_MSG_SIZE, "%c %d", FLOUT_RPC_CMD_HEARTBEAT, worker_id);
 
     while (1) {
         log_message(DEBUG, log_name, "hearbeat");
-        if (write(rpc_socket_fd, char_buffer, char_buffer_size) < 0) {
+        if (flout_worker_send(char_buffer) < 0) {
             log_message(INFO, log_name, "failed to send heartbat: %s", strerror(errno));
         }
         sleep(interval_s);
@@ -40,6 +70,194 @@ void * flout_worker_heartbeat_fn(void * msg)
 }
 
 
+/**
+ * Take over a key group, previously owned by worker previous_owner, resuming from the state it has handed over.
+ * previous_owner is -1 if the key group was unassigned or its owner is gone, and state is empty then.
+ */
+void flout_acquire_key_group(const int key_group, const int previous_owner, const long state)
+{
+    const char * log_name = "flout_acquire_key_group";
+
+    // The state is in place before any record of the key group can be processed.
+    pthread_mutex_lock(&key_groups_lock);
+    key_group_state[key_group] = state;
+    owned_key_groups[key_group] = 1;
+    pthread_mutex_unlock(&key_groups_lock);
+    log_message(INFO, log_name, "acquired key group %d from worker %d with state %ld", key_group, previous_owner, state);
+}
+
+
+/**
+ * Stop processing a key group that is being handed over to another worker,
+ * and send its state to the coordinator, which passes it on to the new owner.
+ * Returns 0 on success or -1 if the state could not be sent.
+ */
+int flout_release_key_group(const int key_group)
+{
+    const char * log_name = "flout_release_key_group";
+
+    char message[FLOUT_RPC_MSG_SIZE] = {0};
+    long state;
+
+    pthread_mutex_lock(&key_groups_lock);
+    owned_key_groups[key_group] = 0;
+    state = key_group_state[key_group];
+    key_group_state[key_group] = 0;
+    pthread_mutex_unlock(&key_groups_lock);
+    log_message(INFO, log_name, "released key group %d with state %ld", key_group, state);
+
+    snprintf(message, sizeof(message), "%c %d %ld", FLOUT_RPC_CMD_RELEASED, key_group, state);
+    return flout_worker_send(message);
+}
+
+
+/**
+ * Stop processing every key group, once the coordinator is gone and may have handed them over to other workers.
+ */
+void flout_release_all_key_groups()
+{
+    pthread_mutex_lock(&key_groups_lock);
+    memset(owned_key_groups, 0, sizeof(owned_key_groups));
+    memset(key_group_state, 0, sizeof(key_group_state));
+    pthread_mutex_unlock(&key_groups_lock);
+}
+
+
+/**
+ * Receives commands from the coordinator and executes them.
+ * Returns when the connection to the coordinator is lost, after all key groups have been dropped.
+ */
+void * flout_worker_rpc_fn(void * msg)
+{
+    const char * log_name = "flout_worker_rpc_fn";
+
+    char char_buffer[FLOUT_RPC_MSG_SIZE];
+    char command;
+    int key_group;
+    int previous_owner;
+    long state;
+    int ret_value;
+
+    log_message(INFO, log_name, "initializing rpc thread");
+
+    while (1) {
+        ret_value = flout_rpc_recv(rpc_socket_fd, char_buffer);
+        if (ret_value > 0) {
+            // Nothing has arrived before the socket timeout.
+            continue;
+        }
+        if (ret_value < 0) {
+            log_message(ERROR, log_name, "lost connection to coordinator: %s, dropping all key groups",
+                strerror(errno));
+            flout_release_all_key_groups();
+            return NULL;
+        }
+
+        char_buffer[FLOUT_RPC_MSG_SIZE-1] = '\0';
+        previous_owner = -1;
+        state = 0;
+        if (sscanf(char_buffer, "%c %d %d %ld", &command, &key_group, &previous_owner, &state) < 2
+            || key_group < 0 || key_group >= FLOUT_KEY_GROUPS) {
+            log_message(WARN, log_name, "ignoring malformed command: %s", char_buffer);
+            continue;
+        }
+
+        switch (command) {
+        case FLOUT_RPC_CMD_ACQUIRE:
+            flout_acquire_key_group(key_group, previous_owner, state);
+            break;
+        case FLOUT_RPC_CMD_RELEASE:
+            if (flout_release_key_group(key_group) < 0) {
+                log_message(ERROR, log_name, "could not hand key group %d over: %s", key_group, strerror(errno));
+            }
+            break;
+        default:
+            log_message(WARN, log_name, "ignoring unknown command: %s", char_buffer);
+        }
+    }
+}
+
+
+/**
+ * Fold a record into the state of its key group, if this worker owns it.
+ * Returns 1 if the record has been processed, or 0 if its key group belongs to someone else.
+ */
+int flout_process_record(const uint64_t key)
+{
+    int key_group = flout_key_group_of(&key, sizeof(key));
+    int processed = 0;
+
+    pthread_mutex_lock(&key_groups_lock);
+    if (owned_key_groups[key_group]) {
+        key_group_state[key_group] += key & 0xff;
+        processed = 1;
+    }
+    pthread_mutex_unlock(&key_groups_lock);
+
+    return processed;
+}
+
+
+/**
+ * Body of a thread serving a single client connected to the data endpoint.
+ * Every record gets a reply, telling whether it has been processed or has to be sent to another worker.
+ */
+void * flout_worker_data_connection_fn(void * msg)
+{
+    const char * log_name = "flout_worker_data_connection_fn";
+
+    int client_socket_fd = (int) (intptr_t) msg;
+    char char_buffer[FLOUT_RPC_MSG_SIZE];
+    char command;
+    long sequence;
+    uint64_t key;
+
+    while (flout_rpc_recv(client_socket_fd, char_buffer) == 0) {
+        char_buffer[FLOUT_RPC_MSG_SIZE-1] = '\0';
+        if (sscanf(char_buffer, "%c %ld %" SCNu64, &command, &sequence, &key) != 3
+            || command != FLOUT_RPC_CMD_RECORD) {
+            log_message(WARN, log_name, "ignoring malformed record: %s", char_buffer);
+            continue;
+        }
+
+        memset(char_buffer, 0, sizeof(char_buffer));
+        snprintf(char_buffer, sizeof(char_buffer), "%c %ld",
+            flout_process_record(key) ? FLOUT_RPC_CMD_PROCESSED : FLOUT_RPC_CMD_NOT_OWNER, sequence);
+        if (flout_rpc_send(client_socket_fd, char_buffer) < 0) {
+            break;
+        }
+    }
+
+    close(client_socket_fd);
+    return NULL;
+}
+
+
+/**
+ * Accepts clients on the data endpoint, each of them served by its own thread.
+ */
+void * flout_worker_data_fn(void * msg)
+{
+    const char * log_name = "flout_worker_data_fn";
+
+    int client_socket_fd;
+    pthread_t connection_thread;
+
+    log_message(INFO, log_name, "initializing data thread");
+
+    while (1) {
+        client_socket_fd = accept(data_socket_fd, NULL, NULL);
+        if (client_socket_fd < 0) {
+            log_message(ERROR, log_name, "could not accept a client: %s", strerror(errno));
+            continue;
+        }
+        pthread_create(&connection_thread, NULL, &flout_worker_data_connection_fn,
+            (void *) (intptr_t) client_socket_fd);
+        pthread_detach(connection_thread);
+    }
+}
+
+
 /**
  * Register with a coordinator.
  * Establishes one-time connection with the coordinator under its registration address.
@@ -81,17 +299,18 @@ int flout_register(int worker_rpc_socket_fd, struct sockaddr_in6 * worker_rpc_ad
     }
 
     // Receive worker ID or error code on connection.
-    ret_value = read(rpc_socket_fd, char_buffer, char_buffer_size-1);
+    // Commands may follow right after, so read exactly one message.
+    ret_value = flout_rpc_recv(rpc_socket_fd, char_buffer);
 
-    if (ret_value < 0) {
+    if (ret_value != 0) {
         log_message(ERROR, log_name, "coordinator closed the connection without responding: %s: shutting down",
             strerror(errno));
         close(rpc_socket_fd);
-        return ret_value;
+        return -1;
     }
 
     // Terminate the string in case of overflow and parse the number.
-    char_buffer[char_buffer_size-1] = '\0';
+    char_buffer[FLOUT_RPC_MSG_SIZE-1] = '\0';
     ret_value = strtol(char_buffer, NULL, 10);
 
     if (ret_value < 0) {
@@ -112,28 +331,32 @@ int main(int argc, char* argv[])
     struct sockaddr_in6 coordinator_rpc_addr;
     flout_init_sockaddr_in6(&coordinator_rpc_addr, "::1", 8122);
 
-    // Init an RPC socket for coordinator communication.
-    // It will stay open for the entire lifetime of the worker.
+    // Address of this worker's data endpoint.
     const char * worker_address = "::1";
-    const int worker_port = 8123;
+    // Port can be overridden, so that several workers can run on one host.
+    int worker_port = 8123;
+    if (argc > 1) {
+        worker_port = strtol(argv[1], NULL, 10);
+    }
     struct sockaddr_in6 worker_rpc_addr;
     flout_init_sockaddr_in6(&worker_rpc_addr, worker_address, worker_port);
 
-    rpc_socket_fd = socket(AF_INET6, SOCK_STREAM, 0);
-    if (rpc_socket_fd < 0) {
-        log_message(ERROR, log_name, "could not create an rpc socket: %s: shutting down",
-            strerror(errno));
-            return errno;
-    }
-    if (bind(rpc_socket_fd, (struct sockaddr *)&worker_rpc_addr, sizeof(worker_rpc_addr)) < 0) {
-        log_message(ERROR, log_name, "could not bind to %s:%d: %s: shutting down",
-            worker_address, worker_port, strerror(errno));
+    // Replies to clients that have gone away must not kill the worker.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Clients send records to the data endpoint, which listens on the worker's address.
+    const int data_queue_size = 8;
+    char char_buffer[1024];
+    data_socket_fd = flout_create_outbound_socket((struct sockaddr *) &worker_rpc_addr, data_queue_size,
+        char_buffer, sizeof(char_buffer));
+    if (data_socket_fd < 0) {
+        log_message(ERROR, log_name, "could not create a data socket: %s: shutting down", char_buffer);
         return errno;
     }
-    log_message(INFO, log_name, "initialized worker rpc socket at %s:%d", 
+    log_message(INFO, log_name, "initialized worker data socket at %s:%d",
         worker_address, worker_port);
 
-    worker_id = flout_register(rpc_socket_fd, &worker_rpc_addr, &coordinator_rpc_addr);
+    worker_id = flout_register(data_socket_fd, &worker_rpc_addr, &coordinator_rpc_addr);
 
     log_message(INFO, log_name, "Successfully registered worker, ID %d", worker_id);   
 
@@ -151,7 +374,16 @@ int main(int argc, char* argv[])
 
     pthread_create(&worker_heartbeat_thread, NULL, &flout_worker_heartbeat_fn, (void *) &worker_heartbeat_thread_params);
 
-    pthread_join(worker_heartbeat_thread, NULL);
+    pthread_t worker_rpc_thread;
+    pthread_create(&worker_rpc_thread, NULL, &flout_worker_rpc_fn, NULL);
+
+    pthread_t worker_data_thread;
+    pthread_create(&worker_data_thread, NULL, &flout_worker_data_fn, NULL);
+
+    // A worker that has lost its coordinator is no longer part of the cluster,
+    // so it shuts down, taking the heartbeat and data threads with it.
+    pthread_join(worker_rpc_thread, NULL);
+    log_message(ERROR, log_name, "disconnected from coordinator: shutting down");
 
-    return 0;
+    return 1;
 }
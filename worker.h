@@ -1,14 +1,18 @@
 #ifndef FLOUT_WORKER_H_INCLUDED
 #define FLOUT_WORKER_H_INCLUDED
 
+#include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "utils/err.h"
+#include "utils/keygroups.h"
 #include "utils/log.h"
 #include "utils/net.h"
+#include "utils/rpc.h"
 #include "utils/threading.h"
 
 typedef struct {